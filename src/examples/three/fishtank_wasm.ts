@@ -4,9 +4,8 @@ import {
     AxesHelper, SphereGeometry, BoxGeometry
 } from 'three';
 import { OrbitControls } from 'three/examples/jsm/controls/OrbitControls';
-import { perlin3D } from '../../utils/noise';
 import { ArrayCubeF32 } from '../../utils/arrayMatrix';
-import { createMarchingCubeBlockMeshes, fetchWasm, MarchingCubeService } from '../../utils/marchingCubes/marchingCubes';
+import { BlockMeshScheduler, createMarchingCubeBlockMeshes, fetchWasm, MarchingCubeService } from '../../utils/marchingCubes/marchingCubes';
 const Stats = require('stats.js');
 
 
@@ -78,12 +77,16 @@ document.addEventListener('keydown', (event: KeyboardEvent) => {
 
 
 
+const scheduler = new BlockMeshScheduler(camera, 4);
+
+
 var stats = new Stats();
 stats.showPanel(0); // 0: fps, 1: ms, 2: mb, 3+: custom
 fpser.appendChild(stats.dom);
 function animate() {
     stats.begin();
     requestAnimationFrame(animate);
+    scheduler.runFrame();
     renderer.render(scene, camera);
     stats.end();
 }
@@ -91,34 +94,21 @@ function animate() {
 fetchWasm().subscribe((svc: MarchingCubeService) => {
 
 
-    function spaceFunction(x: number, y: number, z: number): number {
-        return 100 * perlin3D(1 * x / X, 1 * y / Y, 1 * z / Z)
-            + 50 * perlin3D(5 * x / X, 5 * y / Y, 5 * z / Z)
-            + 10 * perlin3D(10 * x / X, 10 * y / Y, 10 * z / Z);
-    }
-
     const X = 300;
     const Y = 100;
     const Z = 300;
-    const allData = new ArrayCubeF32(X, Y, Z);
-    for (let x = 0; x < X; x++) {
-        for (let y = 0; y < Y; y++) {
-            for (let z = 0; z < Z; z++) {
-                if (x !== 0 && y !== 0 && z !== 0 && x !== X - 1 && y !== Y - 1 && z !== Z - 1) {
-                    allData.set(x, y, z, spaceFunction(x, y, z));
-                } else {
-                    allData.set(x, y, z, 0);
-                }
-            }
-        }
-    }
+    const allData = new ArrayCubeF32(X, Y, Z, svc.generateField(X, Y, Z, [
+        { type: 'noise', amplitude: 100, scale: [1 / X, 1 / Y, 1 / Z] },
+        { type: 'noise', amplitude: 50, scale: [5 / X, 5 / Y, 5 / Z] },
+        { type: 'noise', amplitude: 10, scale: [10 / X, 10 / Y, 10 / Z] },
+    ], 0));
     const threshold = 20;
 
     const cubeSize: [number, number, number] = [1, 1, 1];
-    const blockSize: [number, number, number] = [100, 100, 100];
+    const blockSize: [number, number, number] = [50, 50, 50];  // small blocks: each one has to fit into the scheduler's frame-budget
 
 
-    const meshes = createMarchingCubeBlockMeshes(allData, threshold, cubeSize, blockSize, 0, 30, svc);
+    const meshes = createMarchingCubeBlockMeshes(allData, threshold, cubeSize, blockSize, 0, 30, svc, scheduler);
     meshes.map(m => m.mesh.translateX(- cubeSize[0] * X / 2));
     meshes.map(m => m.mesh.translateY(- cubeSize[1] * Y / 2));
     meshes.map(m => m.mesh.translateZ(- cubeSize[2] * Z / 2));
@@ -149,23 +139,26 @@ fetchWasm().subscribe((svc: MarchingCubeService) => {
             const bbox = mesh.getBbox();
 
             if (bbox.xMin <= newX && newX <= bbox.xMax) {
-                const startPointWC = mesh.mesh.position.toArray();
-                const originalData = allData.getSubBlock(mesh.startPoint, mesh.blockSize);
-                const newData = new ArrayCubeF32(mesh.blockSize[0], mesh.blockSize[1], mesh.blockSize[2]);
-                for (let x = 0; x < mesh.blockSize[0]; x++) {
-                    for (let y = 0; y < mesh.blockSize[1]; y++) {
-                        for (let z = 0; z < mesh.blockSize[2]; z++) {
-                            const xVal = startPointWC[0] + x * cubeSize[0];
-                            if (xVal < newX) {
-                                newData.set(x, y, z, 0);
-                            } else {
-                                newData.set(x, y, z,
-                                    originalData.get(x, y, z));
+                // computing the cut-data is expensive, too - so it happens inside the job, where it can be superseded.
+                scheduler.schedule(mesh, 'data', () => {
+                    const startPointWC = mesh.mesh.position.toArray();
+                    const originalData = allData.getSubBlock(mesh.startPoint, mesh.blockSize);
+                    const newData = new ArrayCubeF32(mesh.blockSize[0], mesh.blockSize[1], mesh.blockSize[2]);
+                    for (let x = 0; x < mesh.blockSize[0]; x++) {
+                        for (let y = 0; y < mesh.blockSize[1]; y++) {
+                            for (let z = 0; z < mesh.blockSize[2]; z++) {
+                                const xVal = startPointWC[0] + x * cubeSize[0];
+                                if (xVal < newX) {
+                                    newData.set(x, y, z, 0);
+                                } else {
+                                    newData.set(x, y, z,
+                                        originalData.get(x, y, z));
+                                }
                             }
                         }
                     }
-                }
-                mesh.updateData(newData.data);
+                    mesh.data = newData.data;
+                });
             }
         }
     });
@@ -173,7 +166,10 @@ fetchWasm().subscribe((svc: MarchingCubeService) => {
 
     sliderB.addEventListener('input', (ev: Event) => {
         const newThreshold = 50 * (+(sliderB.value) + 100) / 200;
-        meshes.map(m => m.updateThreshold(newThreshold));
+        meshes.map(m => {
+            m.threshold = newThreshold;
+            scheduler.schedule(m);
+        });
     });
 });
 
@@ -566,9 +566,1390 @@ int mapColors(float* data, int X, int Y, int Z,
 }
 
 
+/**
+ * Isosurface raycasting.
+ * Renders the same `data` volume that `marchCubes` consumes, but without building any triangles:
+ * every pixel shoots a ray into the volume and stops at the first crossing of `threshold`.
+ * Time per frame depends on image- and volume-size only, not on the number of triangles.
+ */
+
+
+float dotProd(Vertex v1, Vertex v2) {
+    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+}
+
+
+Vertex normalize(Vertex v) {
+    float length = __builtin_sqrtf(dotProd(v, v));  // builtin, because there is no libm in wasm
+    if (length == 0) return v;
+    Vertex n = {v.x / length, v.y / length, v.z / length};
+    return n;
+}
+
+
+Vertex pointOnRay(Vertex origin, Vertex direction, float t) {
+    Vertex p = {origin.x + t * direction.x, origin.y + t * direction.y, origin.z + t * direction.z};
+    return p;
+}
+
+
+/**
+ * Trilinear interpolation of `data` at a position given in (fractional) voxel-indices.
+ */
+float sampleTrilinear(float* data, int X, int Y, int Z, Vertex p) {
+    float x = min(max(p.x, 0), X - 1);
+    float y = min(max(p.y, 0), Y - 1);
+    float z = min(max(p.z, 0), Z - 1);
+    int x0 = min(x, X - 2);
+    int y0 = min(y, Y - 2);
+    int z0 = min(z, Z - 2);
+    float fx = x - x0;
+    float fy = y - y0;
+    float fz = z - z0;
+
+    float cubeData[8];
+    fillSubCube(data, cubeData, Y, Z, x0, y0, z0);
+    // same corner-order as in `fillSubCube`
+    float c00 = cubeData[0] + fx * (cubeData[1] - cubeData[0]);
+    float c01 = cubeData[3] + fx * (cubeData[2] - cubeData[3]);
+    float c10 = cubeData[4] + fx * (cubeData[5] - cubeData[4]);
+    float c11 = cubeData[7] + fx * (cubeData[6] - cubeData[7]);
+    float c0 = c00 + fz * (c01 - c00);
+    float c1 = c10 + fz * (c11 - c10);
+    return c0 + fy * (c1 - c0);
+}
+
+
+/**
+ * Empty-space-skipping: the volume is divided into blocks of `blockSize`^3 cells.
+ * For each block we store the min and max of all data-points touching it.
+ * A block whose range does not contain the threshold cannot contain any part of the surface.
+ */
+int getMinMaxGridDimension(int N, int blockSize) {
+    return (N - 2) / blockSize + 1;
+}
+
+
+int getMinMaxGridSize(int X, int Y, int Z, int blockSize) {
+    return getMinMaxGridDimension(X, blockSize) * getMinMaxGridDimension(Y, blockSize) * getMinMaxGridDimension(Z, blockSize);
+}
+
+
+void buildMinMaxGrid(float* data, int X, int Y, int Z, int blockSize, float* blockMins, float* blockMaxs) {
+    int bX = getMinMaxGridDimension(X, blockSize);
+    int bY = getMinMaxGridDimension(Y, blockSize);
+    int bZ = getMinMaxGridDimension(Z, blockSize);
+
+    for (int bx = 0; bx < bX; bx++) {
+        for (int by = 0; by < bY; by++) {
+            for (int bz = 0; bz < bZ; bz++) {
+                int xEnd = min(bx * blockSize + blockSize, X - 1);
+                int yEnd = min(by * blockSize + blockSize, Y - 1);
+                int zEnd = min(bz * blockSize + blockSize, Z - 1);
+                float blockMin = data[cubeIndex(Y, Z, bx * blockSize, by * blockSize, bz * blockSize)];
+                float blockMax = blockMin;
+                for (int x = bx * blockSize; x <= xEnd; x++) {
+                    for (int y = by * blockSize; y <= yEnd; y++) {
+                        for (int z = bz * blockSize; z <= zEnd; z++) {
+                            float val = data[cubeIndex(Y, Z, x, y, z)];
+                            blockMin = min(blockMin, val);
+                            blockMax = max(blockMax, val);
+                        }
+                    }
+                }
+                int b = cubeIndex(bY, bZ, bx, by, bz);
+                blockMins[b] = blockMin;
+                blockMaxs[b] = blockMax;
+            }
+        }
+    }
+}
+
+
+/**
+ * Slab-test. Returns 1 if the ray hits the box, and writes entry- and exit-distance into `tNear` and `tFar`.
+ */
+int intersectBox(Vertex origin, Vertex invDirection, Vertex boxMin, Vertex boxMax, float* tNear, float* tFar) {
+    float tx0 = (boxMin.x - origin.x) * invDirection.x;
+    float tx1 = (boxMax.x - origin.x) * invDirection.x;
+    float ty0 = (boxMin.y - origin.y) * invDirection.y;
+    float ty1 = (boxMax.y - origin.y) * invDirection.y;
+    float tz0 = (boxMin.z - origin.z) * invDirection.z;
+    float tz1 = (boxMax.z - origin.z) * invDirection.z;
+    float tEnter = max(max(min(tx0, tx1), min(ty0, ty1)), min(tz0, tz1));
+    float tExit  = min(min(max(tx0, tx1), max(ty0, ty1)), max(tz0, tz1));
+    *tNear = tEnter;
+    *tFar = tExit;
+    return tEnter <= tExit && tExit >= 0;
+}
+
+
+typedef struct RaycastCamera {
+    Vertex position;
+    Vertex target;
+    Vertex up;
+    float tanHalfFovY;  // tan(fovY / 2); there is no `tanf` in wasm, so we expect it precomputed. 0.577 for 60°.
+} RaycastCamera;
+
+
+typedef struct RaycastScene {
+    float* data;
+    int X;
+    int Y;
+    int Z;
+    float threshold;
+    float cubeWidth;
+    float cubeHeight;
+    float cubeDepth;
+    float x0;
+    float y0;
+    float z0;
+
+    float* blockMins;  // from `buildMinMaxGrid`
+    float* blockMaxs;
+    int blockSize;
+    float stepSize;    // in voxels. Features thinner than this may be missed.
+
+    RaycastCamera camera;
+    Vertex surfaceColor;     // rgb in [0, 1]
+    Vertex backgroundColor;  // rgb in [0, 1]
+
+    int width;
+    int height;
+    unsigned char* pixels;   // width * height * 3, rgb, row-major, top row first
+} RaycastScene;
+
+
+/**
+ * Marches a ray given in voxel-coordinates through the volume.
+ * Returns 1 on a hit and writes the position of the hit into `hit`.
+ */
+int findFirstHit(RaycastScene* s, Vertex origin, Vertex direction, Vertex* hit) {
+    Vertex invDirection = {1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z};
+    Vertex volumeMin = {0, 0, 0};
+    Vertex volumeMax = {s->X - 1, s->Y - 1, s->Z - 1};
+    float tNear, tFar;
+    if (!intersectBox(origin, invDirection, volumeMin, volumeMax, &tNear, &tFar)) return 0;
+
+    int bX = getMinMaxGridDimension(s->X, s->blockSize);
+    int bY = getMinMaxGridDimension(s->Y, s->blockSize);
+    int bZ = getMinMaxGridDimension(s->Z, s->blockSize);
+
+    float t = max(tNear, 0);
+    float previous = sampleTrilinear(s->data, s->X, s->Y, s->Z, pointOnRay(origin, direction, t)) - s->threshold;
+    while (t < tFar) {
+        // which block are we in?
+        Vertex p = pointOnRay(origin, direction, t);
+        int bx = min(max(p.x / s->blockSize, 0), bX - 1);
+        int by = min(max(p.y / s->blockSize, 0), bY - 1);
+        int bz = min(max(p.z / s->blockSize, 0), bZ - 1);
+        int b = cubeIndex(bY, bZ, bx, by, bz);
+
+        if (s->blockMins[b] > s->threshold || s->blockMaxs[b] < s->threshold) {
+            // block cannot contain the surface: jump to where the ray leaves it.
+            Vertex blockMin = {bx * s->blockSize, by * s->blockSize, bz * s->blockSize};
+            Vertex blockMax = {blockMin.x + s->blockSize, blockMin.y + s->blockSize, blockMin.z + s->blockSize};
+            float tBlockNear, tBlockFar;
+            intersectBox(origin, invDirection, blockMin, blockMax, &tBlockNear, &tBlockFar);
+            t = min(max(tBlockFar, t) + 0.001, tFar);
+            previous = sampleTrilinear(s->data, s->X, s->Y, s->Z, pointOnRay(origin, direction, t)) - s->threshold;
+            continue;
+        }
+
+        float tNext = min(t + s->stepSize, tFar);
+        float current = sampleTrilinear(s->data, s->X, s->Y, s->Z, pointOnRay(origin, direction, tNext)) - s->threshold;
+        if ((previous < 0) != (current < 0)) {
+            // refining the hit by bisection on the trilinear field
+            float tLow = t;
+            float tHigh = tNext;
+            for (int i = 0; i < 8; i++) {
+                float tMid = 0.5 * (tLow + tHigh);
+                float mid = sampleTrilinear(s->data, s->X, s->Y, s->Z, pointOnRay(origin, direction, tMid)) - s->threshold;
+                if ((previous < 0) != (mid < 0)) {
+                    tHigh = tMid;
+                } else {
+                    tLow = tMid;
+                    previous = mid;
+                }
+            }
+            *hit = pointOnRay(origin, direction, 0.5 * (tLow + tHigh));
+            return 1;
+        }
+        previous = current;
+        t = tNext;
+    }
+    return 0;
+}
+
+
+/**
+ * Gradient of the trilinear field by central differences, in world-units.
+ */
+Vertex getGradient(RaycastScene* s, Vertex p) {
+    float h = 0.5;
+    Vertex xp = {p.x + h, p.y, p.z};
+    Vertex xm = {p.x - h, p.y, p.z};
+    Vertex yp = {p.x, p.y + h, p.z};
+    Vertex ym = {p.x, p.y - h, p.z};
+    Vertex zp = {p.x, p.y, p.z + h};
+    Vertex zm = {p.x, p.y, p.z - h};
+    Vertex gradient = {
+        (sampleTrilinear(s->data, s->X, s->Y, s->Z, xp) - sampleTrilinear(s->data, s->X, s->Y, s->Z, xm)) / (2 * h * s->cubeWidth),
+        (sampleTrilinear(s->data, s->X, s->Y, s->Z, yp) - sampleTrilinear(s->data, s->X, s->Y, s->Z, ym)) / (2 * h * s->cubeHeight),
+        (sampleTrilinear(s->data, s->X, s->Y, s->Z, zp) - sampleTrilinear(s->data, s->X, s->Y, s->Z, zm)) / (2 * h * s->cubeDepth)
+    };
+    return gradient;
+}
+
+
+/**
+ * Renders the pixels [xStart, xEnd) x [yStart, yEnd) into `s->pixels`.
+ * Tiles don't share any state, so they can be rendered in parallel.
+ */
+void raycastTile(RaycastScene* s, int xStart, int yStart, int xEnd, int yEnd) {
+    RaycastCamera c = s->camera;
+    Vertex forward = normalize(vertexMin(c.position, c.target));
+    Vertex right = normalize(crossProd(forward, c.up));
+    Vertex up = crossProd(right, forward);
+    float aspect = (float)s->width / (float)s->height;
+
+    // rays are marched in voxel-coordinates, so that `stepSize` and the min-max-grid are in voxels, too.
+    Vertex origin = {
+        (c.position.x - s->x0) / s->cubeWidth,
+        (c.position.y - s->y0) / s->cubeHeight,
+        (c.position.z - s->z0) / s->cubeDepth
+    };
+
+    for (int py = yStart; py < yEnd; py++) {
+        for (int px = xStart; px < xEnd; px++) {
+            float u = (2.0 * (px + 0.5) / s->width - 1.0) * c.tanHalfFovY * aspect;
+            float v = (1.0 - 2.0 * (py + 0.5) / s->height) * c.tanHalfFovY;
+            Vertex rayWorld = normalize((Vertex){
+                forward.x + u * right.x + v * up.x,
+                forward.y + u * right.y + v * up.y,
+                forward.z + u * right.z + v * up.z
+            });
+            Vertex rayVoxel = normalize((Vertex){
+                rayWorld.x / s->cubeWidth,
+                rayWorld.y / s->cubeHeight,
+                rayWorld.z / s->cubeDepth
+            });
+
+            Vertex color = s->backgroundColor;
+            Vertex hit;
+            if (findFirstHit(s, origin, rayVoxel, &hit)) {
+                // headlight: light comes from the camera
+                Vertex normal = normalize(getGradient(s, hit));
+                float diffuse = dotProd(normal, rayWorld);
+                if (diffuse < 0) diffuse = -diffuse;
+                float shade = 0.2 + 0.8 * diffuse;
+                color.x = s->surfaceColor.x * shade;
+                color.y = s->surfaceColor.y * shade;
+                color.z = s->surfaceColor.z * shade;
+            }
+
+            int i = (py * s->width + px) * 3;
+            s->pixels[i    ] = min(max(color.x, 0), 1) * 255;
+            s->pixels[i + 1] = min(max(color.y, 0), 1) * 255;
+            s->pixels[i + 2] = min(max(color.z, 0), 1) * 255;
+        }
+    }
+}
+
+
+void raycastImage(RaycastScene* s) {
+    raycastTile(s, 0, 0, s->width, s->height);
+}
+
+
+/**
+ * Procedural volumes.
+ * Fills a `data` volume (same layout as `marchCubes` expects) from a list of `FieldTerm`s.
+ * Work is done one z-row at a time: everything that only depends on x and y is computed once per row,
+ * and the inner loops over z are branch-free so that the compiler can vectorize them (SSE natively, simd128 in wasm).
+ */
+
+
+// Ken Perlin's permutation - the same one as in `noise.ts`, so that `perlin3D` gives identical results.
+int permutation[256] = {
+    151, 160, 137, 91, 90, 15,
+    131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23,
+    190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33,
+    88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166,
+    77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244,
+    102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196,
+    135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123,
+    5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42,
+    223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+    129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228,
+    251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107,
+    49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254,
+    138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
+};
+
+
+int perm(int i) {
+    return permutation[i & 255];
+}
+
+
+// The 16 cases of `grad3D` from `noise.ts` as coefficient-tables: grad = gradX[h] * x + gradY[h] * y + gradZ[h] * z
+float gradX[16] = {1, -1,  1, -1, 1, -1,  1, -1, 0,  0,  0,  0, 1,  0, -1,  0};
+float gradY[16] = {1,  1, -1, -1, 0,  0,  0,  0, 1, -1,  1, -1, 1, -1,  1, -1};
+float gradZ[16] = {0,  0,  0,  0, 1,  1, -1, -1, 1,  1, -1, -1, 0,  1,  0, -1};
+
+
+float grad3D(int hash, float x, float y, float z) {
+    int h = hash & 15;
+    return gradX[h] * x + gradY[h] * y + gradZ[h] * z;
+}
+
+
+#define FIELD_CHUNK 64
+
+
+float fade(float t) {
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+
+float lerp(float t, float a, float b) {
+    return a + t * (b - a);
+}
+
+
+/**
+ * Evaluates `perlin3D` at the `n` points (x, y, z + i * dz), n <= FIELD_CHUNK.
+ * First loop does the table-lookups, second loop the arithmetic - the latter vectorizes.
+ */
+void perlin3DRow(float* out, int n, float x, float y, float z, float dz) {
+    float xFloor = __builtin_floorf(x);
+    float yFloor = __builtin_floorf(y);
+    int Xi = (int)xFloor & 255;
+    int Yi = (int)yFloor & 255;
+    x -= xFloor;
+    y -= yFloor;
+    float u = fade(x);
+    float v = fade(y);
+
+    // hashes of the four corners in the xy-plane are constant along the row
+    int aa = perm(perm(Xi) + Yi);
+    int ab = perm(perm(Xi) + Yi + 1);
+    int ba = perm(perm(Xi + 1) + Yi);
+    int bb = perm(perm(Xi + 1) + Yi + 1);
+
+    // per corner, the part of the gradient-dot-product that doesn't depend on z, plus the z-coefficient.
+    // These only change when the row enters a new unit-cube, which for low frequencies is rare.
+    float xyGrad[8][FIELD_CHUNK];
+    float zGrad[8][FIELD_CHUNK];
+    float zr[FIELD_CHUNK];
+    float cellXyGrad[8] = {0};
+    float cellZGrad[8] = {0};
+    int lastZi = -1;
+    for (int i = 0; i < n; i++) {
+        float zi = z + i * dz;
+        float zFloor = __builtin_floorf(zi);
+        int Zi = (int)zFloor & 255;
+        zr[i] = zi - zFloor;
+        if (Zi != lastZi) {
+            int hashes[8] = {
+                perm(aa + Zi), perm(ba + Zi), perm(ab + Zi), perm(bb + Zi),
+                perm(aa + Zi + 1), perm(ba + Zi + 1), perm(ab + Zi + 1), perm(bb + Zi + 1)
+            };
+            for (int c = 0; c < 8; c++) {
+                int h = hashes[c] & 15;
+                float cx = (c & 1) ? x - 1 : x;
+                float cy = (c & 2) ? y - 1 : y;
+                cellXyGrad[c] = gradX[h] * cx + gradY[h] * cy;
+                cellZGrad[c] = gradZ[h];
+            }
+            lastZi = Zi;
+        }
+        for (int c = 0; c < 8; c++) {
+            xyGrad[c][i] = cellXyGrad[c];
+            zGrad[c][i] = cellZGrad[c];
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        float z0 = zr[i];
+        float z1 = zr[i] - 1;
+        float w = fade(z0);
+        float aaa = xyGrad[0][i] + zGrad[0][i] * z0;
+        float baa = xyGrad[1][i] + zGrad[1][i] * z0;
+        float aba = xyGrad[2][i] + zGrad[2][i] * z0;
+        float bba = xyGrad[3][i] + zGrad[3][i] * z0;
+        float aab = xyGrad[4][i] + zGrad[4][i] * z1;
+        float bab = xyGrad[5][i] + zGrad[5][i] * z1;
+        float abb = xyGrad[6][i] + zGrad[6][i] * z1;
+        float bbb = xyGrad[7][i] + zGrad[7][i] * z1;
+        out[i] = lerp(w, lerp(v, lerp(u, aaa, baa), lerp(u, aba, bba)),
+                         lerp(v, lerp(u, aab, bab), lerp(u, abb, bbb)));
+    }
+}
+
+
+float perlin3D(float x, float y, float z) {
+    float out;
+    perlin3DRow(&out, 1, x, y, z, 0);
+    return out;
+}
+
+
+/**
+ * sin without libm: range-reduction to [-pi, pi], folding to [0, pi/2], then a Taylor-polynomial.
+ * Error < 4e-6 near 0; the float range-reduction adds ~1e-7 * |x|.
+ * Written without branches or comparisons, so that loops calling it still vectorize.
+ */
+float approxSin(float x) {
+    float pi = 3.14159265;
+    float turns = x / (2 * pi);
+    x = x - 2 * pi * (float)(int)(turns + __builtin_copysignf(0.5, turns));  // (int) truncates; adding +-0.5 makes it round
+    // sin(x) = sign(x) * sin(|x|), and sin(|x|) = sin(pi/2 - ||x| - pi/2|) on [0, pi]
+    float a = pi / 2 - __builtin_fabsf(__builtin_fabsf(x) - pi / 2);
+    float a2 = a * a;
+    float sinA = a * (1 + a2 * (-1.0 / 6.0 + a2 * (1.0 / 120.0 + a2 * (-1.0 / 5040.0 + a2 * (1.0 / 362880.0)))));
+    return __builtin_copysignf(sinA, x);
+}
+
+
+float approxCos(float x) {
+    return approxSin(x + 3.14159265 / 2);
+}
+
+
+#define FIELD_NOISE 0
+#define FIELD_SPHERE 1
+#define FIELD_BOX 2
+#define FIELD_GYROID 3
+
+#define COMBINE_ADD 0
+#define COMBINE_UNION 1
+#define COMBINE_INTERSECT 2
+#define COMBINE_SUBTRACT 3
+
+
+/**
+ * One ingredient of a procedural volume. All positions are in voxels.
+ * Solid shapes are positive inside and negative outside - pick a threshold of 0 to mesh their surface.
+ *  - FIELD_NOISE:  sum over `octaves` of amplitude * persistence^o * perlin3D((p - center) * scale * lacunarity^o)
+ *  - FIELD_SPHERE: amplitude * (size.x - |p - center|)
+ *  - FIELD_BOX:    amplitude * -sdf of a box with half-extents `size`
+ *  - FIELD_GYROID: amplitude * (thickness - |gyroid((p - center) * scale)|), a sheet of width ~`thickness`
+ * `combine` says how a term is merged with the terms before it. The first term's `combine` is ignored.
+ * Layout is mirrored in `marchingCubes.ts` - keep both in sync.
+ */
+typedef struct FieldTerm {
+    int type;
+    int combine;
+    int octaves;
+    float amplitude;
+    float persistence;
+    float lacunarity;
+    float thickness;
+    Vertex center;
+    Vertex scale;
+    Vertex size;
+} FieldTerm;
+
+
+void evaluateFieldTermRow(FieldTerm* t, float* out, int n, int x, int y, int z) {
+    float dx = x - t->center.x;
+    float dy = y - t->center.y;
+    float dz = z - t->center.z;
+
+    if (t->type == FIELD_NOISE) {
+        for (int i = 0; i < n; i++) out[i] = 0;
+        float octave[FIELD_CHUNK];
+        float amplitude = t->amplitude;
+        float frequency = 1;
+        for (int o = 0; o < t->octaves; o++) {
+            perlin3DRow(octave, n,
+                dx * t->scale.x * frequency, dy * t->scale.y * frequency,
+                dz * t->scale.z * frequency, t->scale.z * frequency);
+            for (int i = 0; i < n; i++) out[i] += amplitude * octave[i];
+            amplitude *= t->persistence;
+            frequency *= t->lacunarity;
+        }
+    }
+
+    else if (t->type == FIELD_SPHERE) {
+        float dxy2 = dx * dx + dy * dy;
+        for (int i = 0; i < n; i++) {
+            float dzi = dz + i;
+            out[i] = t->amplitude * (t->size.x - __builtin_sqrtf(dxy2 + dzi * dzi));
+        }
+    }
+
+    else if (t->type == FIELD_BOX) {
+        float qx = (dx < 0 ? -dx : dx) - t->size.x;
+        float qy = (dy < 0 ? -dy : dy) - t->size.y;
+        float qxOut = max(qx, 0);
+        float qyOut = max(qy, 0);
+        float qxy = max(qx, qy);
+        float qxyOut2 = qxOut * qxOut + qyOut * qyOut;
+        float sizeZ = t->size.z;
+        float amplitude = t->amplitude;
+        for (int i = 0; i < n; i++) {
+            // max/min written with fabs: comparisons would keep the loop from vectorizing
+            float qz = __builtin_fabsf(dz + i) - sizeZ;
+            float qzOut = 0.5 * (qz + __builtin_fabsf(qz));                       // max(qz, 0)
+            float outside = __builtin_sqrtf(qxyOut2 + qzOut * qzOut);
+            float qMax = 0.5 * (qz + qxy + __builtin_fabsf(qz - qxy));            // max(qz, qxy)
+            float inside = 0.5 * (qMax - __builtin_fabsf(qMax));                  // min(qMax, 0)
+            out[i] = -amplitude * (outside + inside);
+        }
+    }
+
+    else if (t->type == FIELD_GYROID) {
+        float sx = approxSin(dx * t->scale.x);
+        float cx = approxCos(dx * t->scale.x);
+        float sy = approxSin(dy * t->scale.y);
+        float cy = approxCos(dy * t->scale.y);
+        float scaleZ = t->scale.z;
+        float amplitude = t->amplitude;
+        float thickness = t->thickness;
+        for (int i = 0; i < n; i++) {
+            float zs = (dz + i) * scaleZ;
+            float g = sx * cy + sy * approxCos(zs) + approxSin(zs) * cx;
+            out[i] = amplitude * (thickness - __builtin_fabsf(g));
+        }
+    }
+
+    else {
+        for (int i = 0; i < n; i++) out[i] = 0;
+    }
+}
+
+
+void combineFieldRow(int combine, float* acc, float* values, int n) {
+    switch (combine) {
+        case COMBINE_UNION:
+            for (int i = 0; i < n; i++) acc[i] = max(acc[i], values[i]);
+            break;
+        case COMBINE_INTERSECT:
+            for (int i = 0; i < n; i++) acc[i] = min(acc[i], values[i]);
+            break;
+        case COMBINE_SUBTRACT:
+            for (int i = 0; i < n; i++) acc[i] = min(acc[i], -values[i]);
+            break;
+        default:  // COMBINE_ADD
+            for (int i = 0; i < n; i++) acc[i] += values[i];
+            break;
+    }
+}
+
+
+/**
+ * Fills the slabs x in [xStart, xEnd) of `data`. Slabs don't overlap, so they can be generated in parallel.
+ */
+void generateFieldSlabs(float* data, int X, int Y, int Z, FieldTerm* terms, int nrTerms, int xStart, int xEnd) {
+    float values[FIELD_CHUNK];
+    for (int x = xStart; x < xEnd && x < X; x++) {
+        for (int y = 0; y < Y; y++) {
+            for (int z = 0; z < Z; z += FIELD_CHUNK) {
+                int n = Z - z < FIELD_CHUNK ? Z - z : FIELD_CHUNK;
+                float* row = &data[cubeIndex(Y, Z, x, y, z)];
+                for (int i = 0; i < n; i++) row[i] = 0;
+                for (int t = 0; t < nrTerms; t++) {
+                    evaluateFieldTermRow(&terms[t], values, n, x, y, z);
+                    combineFieldRow(t == 0 ? COMBINE_ADD : terms[t].combine, row, values, n);
+                }
+            }
+        }
+    }
+}
+
+
+void generateField(float* data, int X, int Y, int Z, FieldTerm* terms, int nrTerms) {
+    generateFieldSlabs(data, X, Y, Z, terms, nrTerms, 0, X);
+}
+
+
+/**
+ * Sets all data-points on the outer faces of the volume to `value`, so that `marchCubes` produces closed surfaces.
+ */
+void fillBorder(float* data, int X, int Y, int Z, float value) {
+    for (int x = 0; x < X; x++) {
+        for (int y = 0; y < Y; y++) {
+            if (x == 0 || y == 0 || x == X - 1 || y == Y - 1) {
+                for (int z = 0; z < Z; z++) data[cubeIndex(Y, Z, x, y, z)] = value;
+            } else {
+                data[cubeIndex(Y, Z, x, y, 0)] = value;
+                data[cubeIndex(Y, Z, x, y, Z - 1)] = value;
+            }
+        }
+    }
+}
+
+
 // The following code is only compiled and executed when the target is not wasm.
 #ifdef __unix__
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+
+typedef struct TileQueue {
+    RaycastScene* scene;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+    int nextTile;  // shared between threads; only ever touched atomically
+} TileQueue;
+
+
+void* raycastWorker(void* arg) {
+    TileQueue* q = (TileQueue*)arg;
+    int nrTiles = q->tilesX * q->tilesY;
+    while (1) {
+        int tile = __atomic_fetch_add(&q->nextTile, 1, __ATOMIC_RELAXED);
+        if (tile >= nrTiles) break;
+        int xStart = (tile % q->tilesX) * q->tileSize;
+        int yStart = (tile / q->tilesX) * q->tileSize;
+        int xEnd = xStart + q->tileSize < q->scene->width ? xStart + q->tileSize : q->scene->width;
+        int yEnd = yStart + q->tileSize < q->scene->height ? yStart + q->tileSize : q->scene->height;
+        raycastTile(q->scene, xStart, yStart, xEnd, yEnd);
+    }
+    return NULL;
+}
+
+
+/**
+ * Renders `s` with `nrThreads` threads pulling 32x32 tiles from a shared counter.
+ * Neighboring pixels tend to need the same amount of work, so small tiles keep the threads evenly loaded.
+ * `nrThreads <= 0` uses one thread per online core.
+ */
+int raycastImageParallel(RaycastScene* s, int nrThreads) {
+    if (nrThreads <= 0) nrThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nrThreads <= 0) nrThreads = 1;
+
+    TileQueue q;
+    q.scene = s;
+    q.tileSize = 32;
+    q.tilesX = (s->width + q.tileSize - 1) / q.tileSize;
+    q.tilesY = (s->height + q.tileSize - 1) / q.tileSize;
+    q.nextTile = 0;
+
+    // the calling thread is the first worker, so only `nrThreads - 1` additional threads are started
+    pthread_t threads[nrThreads];
+    int nrStarted = 0;
+    for (int i = 1; i < nrThreads; i++) {
+        if (pthread_create(&threads[nrStarted], NULL, raycastWorker, &q) != 0) break;
+        nrStarted += 1;
+    }
+    raycastWorker(&q);  // also covers the case where no thread could be started.
+    for (int i = 0; i < nrStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return 0;
+}
+
+
+int writePPM(const char* path, unsigned char* pixels, int width, int height) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    fprintf(f, "P6\n%i %i\n255\n", width, height);
+    size_t nrBytes = (size_t)width * height * 3;
+    size_t written = fwrite(pixels, 1, nrBytes, f);
+    fclose(f);
+    return written == nrBytes ? 0 : -1;
+}
+
+
+unsigned int crc32Update(unsigned int crc, const unsigned char* bytes, size_t length) {
+    static unsigned int table[256];
+    static int tableReady = 0;
+    if (!tableReady) {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = 1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+
+void writeBigEndian32(unsigned char* out, unsigned int v) {
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+
+/**
+ * Writes a PNG chunk: length, type, data, crc over type and data.
+ */
+int writePNGChunk(FILE* f, const char* type, const unsigned char* data, unsigned int length) {
+    unsigned char header[8];
+    writeBigEndian32(header, length);
+    memcpy(header + 4, type, 4);
+    unsigned int crc = crc32Update(0xFFFFFFFFu, header + 4, 4);
+    crc = crc32Update(crc, data, length) ^ 0xFFFFFFFFu;
+    unsigned char footer[4];
+    writeBigEndian32(footer, crc);
+    if (fwrite(header, 1, 8, f) != 8) return -1;
+    if (length > 0 && fwrite(data, 1, length, f) != length) return -1;
+    if (fwrite(footer, 1, 4, f) != 4) return -1;
+    return 0;
+}
+
+
+/**
+ * Writes an rgb-PNG without depending on zlib: the image is stored in uncompressed ("stored") deflate-blocks.
+ * Files are about as large as a PPM, but any image viewer or browser can open them.
+ */
+int writePNG(const char* path, unsigned char* pixels, int width, int height) {
+    size_t rowLength = (size_t)width * 3 + 1;  // every row starts with filter-type 0
+    size_t rawLength = rowLength * height;
+    size_t nrBlocks = (rawLength + 65534) / 65535;
+    size_t idatLength = 2 + rawLength + nrBlocks * 5 + 4;
+    unsigned char* idat = malloc(idatLength);
+    if (!idat) return -1;
+
+    // zlib-stream: header, stored blocks, adler32 of the raw data
+    size_t o = 0;
+    idat[o++] = 0x78;
+    idat[o++] = 0x01;
+    unsigned int adlerA = 1;
+    unsigned int adlerB = 0;
+    size_t rawPos = 0;
+    while (rawPos < rawLength) {
+        size_t blockLength = rawLength - rawPos < 65535 ? rawLength - rawPos : 65535;
+        idat[o++] = rawPos + blockLength == rawLength ? 1 : 0;
+        idat[o++] = blockLength & 0xFF;
+        idat[o++] = (blockLength >> 8) & 0xFF;
+        idat[o++] = ~blockLength & 0xFF;
+        idat[o++] = (~blockLength >> 8) & 0xFF;
+        for (size_t i = 0; i < blockLength; i++, rawPos++) {
+            size_t row = rawPos / rowLength;
+            size_t col = rawPos % rowLength;
+            unsigned char byte = col == 0 ? 0 : pixels[row * width * 3 + col - 1];
+            idat[o++] = byte;
+            adlerA = (adlerA + byte) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+    }
+    writeBigEndian32(idat + o, (adlerB << 16) | adlerA);
+
+    unsigned char ihdr[13];
+    writeBigEndian32(ihdr, width);
+    writeBigEndian32(ihdr + 4, height);
+    ihdr[8] = 8;   // bit depth
+    ihdr[9] = 2;   // color type: rgb
+    ihdr[10] = 0;  // compression
+    ihdr[11] = 0;  // filter
+    ihdr[12] = 0;  // no interlacing
+
+    int error = -1;
+    FILE* f = fopen(path, "wb");
+    if (f) {
+        const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        error = fwrite(signature, 1, 8, f) == 8 ? 0 : -1;
+        if (!error) error = writePNGChunk(f, "IHDR", ihdr, 13);
+        if (!error) error = writePNGChunk(f, "IDAT", idat, idatLength);
+        if (!error) error = writePNGChunk(f, "IEND", NULL, 0);
+        fclose(f);
+    }
+    free(idat);
+    return error;
+}
+
+
+/**
+ * One-call preview for headless machines: builds the min-max-grid, renders with all cores
+ * and writes the image as PNG if `path` ends with ".png", as PPM otherwise.
+ */
+int renderIsosurfacePreview(const char* path, float* data, int X, int Y, int Z,
+                float threshold,
+                float cubeWidth, float cubeHeight, float cubeDepth,
+                float x0, float y0, float z0,
+                RaycastCamera camera, int width, int height) {
+    RaycastScene s;
+    s.data = data;
+    s.X = X;
+    s.Y = Y;
+    s.Z = Z;
+    s.threshold = threshold;
+    s.cubeWidth = cubeWidth;
+    s.cubeHeight = cubeHeight;
+    s.cubeDepth = cubeDepth;
+    s.x0 = x0;
+    s.y0 = y0;
+    s.z0 = z0;
+    s.blockSize = 8;
+    s.stepSize = 0.5;
+    s.camera = camera;
+    s.surfaceColor = (Vertex){1, 1, 1};
+    s.backgroundColor = (Vertex){0, 0, 0};
+    s.width = width;
+    s.height = height;
+
+    int gridSize = getMinMaxGridSize(X, Y, Z, s.blockSize);
+    s.blockMins = malloc(gridSize * sizeof(float));
+    s.blockMaxs = malloc(gridSize * sizeof(float));
+    s.pixels = malloc((size_t)width * height * 3);
+    int error = -1;
+    if (s.blockMins && s.blockMaxs && s.pixels) {
+        buildMinMaxGrid(data, X, Y, Z, s.blockSize, s.blockMins, s.blockMaxs);
+        raycastImageParallel(&s, 0);
+        size_t pathLength = strlen(path);
+        if (pathLength >= 4 && strcmp(path + pathLength - 4, ".png") == 0) {
+            error = writePNG(path, s.pixels, width, height);
+        } else {
+            error = writePPM(path, s.pixels, width, height);
+        }
+    }
+    free(s.blockMins);
+    free(s.blockMaxs);
+    free(s.pixels);
+    return error;
+}
+
+
+typedef struct FieldJob {
+    float* data;
+    int X;
+    int Y;
+    int Z;
+    FieldTerm* terms;
+    int nrTerms;
+    int xStart;
+    int xEnd;
+} FieldJob;
+
+
+void* fieldWorker(void* arg) {
+    FieldJob* j = (FieldJob*)arg;
+    generateFieldSlabs(j->data, j->X, j->Y, j->Z, j->terms, j->nrTerms, j->xStart, j->xEnd);
+    return NULL;
+}
+
+
+/**
+ * `generateField`, split into one range of x-slabs per thread. Every data-point costs the same, so a static split is enough.
+ * `nrThreads <= 0` uses one thread per online core.
+ */
+int generateFieldParallel(float* data, int X, int Y, int Z, FieldTerm* terms, int nrTerms, int nrThreads) {
+    if (nrThreads <= 0) nrThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nrThreads <= 0) nrThreads = 1;
+    if (nrThreads > X) nrThreads = X;
+
+    pthread_t threads[nrThreads];
+    FieldJob jobs[nrThreads];
+    int slabsPerThread = (X + nrThreads - 1) / nrThreads;
+    for (int i = 0; i < nrThreads; i++) {
+        FieldJob job = {data, X, Y, Z, terms, nrTerms, i * slabsPerThread, (i + 1) * slabsPerThread};
+        jobs[i] = job;
+    }
+
+    int started[nrThreads];
+    for (int i = 1; i < nrThreads; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fieldWorker, &jobs[i]) == 0;
+        if (!started[i]) fieldWorker(&jobs[i]);
+    }
+    fieldWorker(&jobs[0]);
+    for (int i = 1; i < nrThreads; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    return 0;
+}
+
+
+/**
+ * Mesh export.
+ * `marchCubes` outputs a triangle-soup: every triangle has its own three vertices, in cell-order.
+ * For distribution we weld that into an indexed mesh, reorder the triangles for the GPU's post-transform vertex-cache
+ * and write it as binary PLY or GLB. Files are written through a small fixed-size buffer, never built up in memory.
+ */
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "PLY- and GLB-export write little-endian data by copying memory as is."
+#endif
+
+
+typedef struct IndexedMesh {
+    int nrVertices;
+    int nrTriangles;
+    Vertex* positions;
+    Vertex* normals;
+    Vertex* colors;          // NULL if the mesh has no colors
+    unsigned int* indices;   // 3 per triangle
+} IndexedMesh;
+
+
+void freeIndexedMesh(IndexedMesh* mesh) {
+    free(mesh->positions);
+    free(mesh->normals);
+    free(mesh->colors);
+    free(mesh->indices);
+    mesh->positions = NULL;
+    mesh->normals = NULL;
+    mesh->colors = NULL;
+    mesh->indices = NULL;
+}
+
+
+unsigned int hashPosition(int qx, int qy, int qz) {
+    return (unsigned int)qx * 73856093u ^ (unsigned int)qy * 19349663u ^ (unsigned int)qz * 83492791u;
+}
+
+
+/**
+ * Merges all vertices of the soup that lie within `epsilon` of each other (compared on a grid of cell-size `epsilon`,
+ * so pick it well below the cube-size; cubeSize / 1024 works for `marchCubes` output).
+ * Normals are area-weighted sums of the face-normals, colors are averaged. `colors` may be NULL.
+ * Triangles that collapse when welding are dropped. Returns 0 on success.
+ */
+int weldVertices(Vertex* vertices, Vertex* colors, int nrVertices, float epsilon, IndexedMesh* mesh) {
+    int capacity = 1;
+    while (capacity < 2 * nrVertices) capacity *= 2;
+    int* table = malloc(capacity * sizeof(int));
+    int* quantized = malloc((size_t)nrVertices * 3 * sizeof(int));
+    int* counts = malloc(nrVertices * sizeof(int));
+    mesh->positions = malloc(nrVertices * sizeof(Vertex));
+    mesh->normals = malloc(nrVertices * sizeof(Vertex));
+    mesh->colors = colors ? malloc(nrVertices * sizeof(Vertex)) : NULL;
+    mesh->indices = malloc(nrVertices * sizeof(unsigned int));
+    if (!table || !quantized || !counts || !mesh->positions || !mesh->normals || (colors && !mesh->colors) || !mesh->indices) {
+        free(table);
+        free(quantized);
+        free(counts);
+        freeIndexedMesh(mesh);
+        return -1;
+    }
+    for (int i = 0; i < capacity; i++) table[i] = -1;
+
+    int nrUnique = 0;
+    int nrIndices = 0;
+    for (int t = 0; t + 2 < nrVertices; t += 3) {
+        int corners[3];
+        for (int c = 0; c < 3; c++) {
+            Vertex v = vertices[t + c];
+            int qx = (int)__builtin_floorf(v.x / epsilon + 0.5);
+            int qy = (int)__builtin_floorf(v.y / epsilon + 0.5);
+            int qz = (int)__builtin_floorf(v.z / epsilon + 0.5);
+            unsigned int slot = hashPosition(qx, qy, qz) & (capacity - 1);
+            while (table[slot] != -1) {  // linear probing
+                int u = table[slot];
+                if (quantized[3 * u] == qx && quantized[3 * u + 1] == qy && quantized[3 * u + 2] == qz) break;
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (table[slot] == -1) {
+                table[slot] = nrUnique;
+                quantized[3 * nrUnique] = qx;
+                quantized[3 * nrUnique + 1] = qy;
+                quantized[3 * nrUnique + 2] = qz;
+                mesh->positions[nrUnique] = v;
+                mesh->normals[nrUnique] = (Vertex){0, 0, 0};
+                if (colors) mesh->colors[nrUnique] = (Vertex){0, 0, 0};
+                counts[nrUnique] = 0;
+                nrUnique += 1;
+            }
+            corners[c] = table[slot];
+        }
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2]) continue;
+
+        Vertex normal = crossProd(vertexMin(vertices[t + 1], vertices[t]), vertexMin(vertices[t + 2], vertices[t]));
+        for (int c = 0; c < 3; c++) {
+            int u = corners[c];
+            mesh->indices[nrIndices++] = u;
+            mesh->normals[u].x += normal.x;
+            mesh->normals[u].y += normal.y;
+            mesh->normals[u].z += normal.z;
+            if (colors) {
+                mesh->colors[u].x += colors[t + c].x;
+                mesh->colors[u].y += colors[t + c].y;
+                mesh->colors[u].z += colors[t + c].z;
+            }
+            counts[u] += 1;
+        }
+    }
+
+    for (int u = 0; u < nrUnique; u++) {
+        mesh->normals[u] = normalize(mesh->normals[u]);
+        if (colors && counts[u] > 0) {
+            mesh->colors[u].x /= counts[u];
+            mesh->colors[u].y /= counts[u];
+            mesh->colors[u].z /= counts[u];
+        }
+    }
+    mesh->nrVertices = nrUnique;
+    mesh->nrTriangles = nrIndices / 3;
+
+    free(table);
+    free(quantized);
+    free(counts);
+
+    // the arrays were sized for the soup; welding typically leaves 1/6 of the vertices, so give the rest back.
+    // Shrinking can't fail in practice, but if it does, the larger arrays are still valid.
+    size_t attributeSize = (nrUnique > 0 ? nrUnique : 1) * sizeof(Vertex);
+    Vertex* positions = realloc(mesh->positions, attributeSize);
+    if (positions) mesh->positions = positions;
+    Vertex* normals = realloc(mesh->normals, attributeSize);
+    if (normals) mesh->normals = normals;
+    if (colors) {
+        Vertex* shrunkColors = realloc(mesh->colors, attributeSize);
+        if (shrunkColors) mesh->colors = shrunkColors;
+    }
+    unsigned int* indices = realloc(mesh->indices, (nrIndices > 0 ? nrIndices : 1) * sizeof(unsigned int));
+    if (indices) mesh->indices = indices;
+    return 0;
+}
+
+
+#define VERTEX_CACHE_SIZE 32
+#define VERTEX_VALENCE_TABLE_SIZE 64
+
+
+/**
+ * Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle whose vertices are
+ * most recently used (cache-score) and have the fewest remaining triangles (valence-score).
+ * Afterwards vertices are renumbered in order of first use, so that vertex-fetches are sequential, too.
+ * Returns 0 on success; on allocation failure the mesh is left untouched.
+ */
+int optimizeVertexCache(IndexedMesh* mesh) {
+    int nrVertices = mesh->nrVertices;
+    int nrTriangles = mesh->nrTriangles;
+    unsigned int* indices = mesh->indices;
+
+    float cacheScores[VERTEX_CACHE_SIZE];
+    for (int p = 0; p < VERTEX_CACHE_SIZE; p++) {
+        // the last triangle's vertices get a fixed score, so that we don't simply continue a strip
+        cacheScores[p] = p < 3 ? 0.75 : powf(1.0 - (p - 3) * (1.0 / (VERTEX_CACHE_SIZE - 3)), 1.5);
+    }
+    float valenceScores[VERTEX_VALENCE_TABLE_SIZE];
+    valenceScores[0] = 0;
+    for (int n = 1; n < VERTEX_VALENCE_TABLE_SIZE; n++) {
+        valenceScores[n] = 2.0 * powf(n, -0.5);
+    }
+
+    int* adjacencyOffsets = malloc((nrVertices + 1) * sizeof(int));
+    int* adjacency = malloc((size_t)nrTriangles * 3 * sizeof(int));
+    int* remaining = calloc(nrVertices, sizeof(int));
+    float* vertexScores = malloc(nrVertices * sizeof(float));
+    float* triangleScores = malloc(nrTriangles * sizeof(float));
+    char* emitted = calloc(nrTriangles, 1);
+    unsigned int* newIndices = malloc((size_t)nrTriangles * 3 * sizeof(unsigned int));
+    int* remap = malloc(nrVertices * sizeof(int));
+    if (!adjacencyOffsets || !adjacency || !remaining || !vertexScores || !triangleScores || !emitted || !newIndices || !remap) {
+        free(adjacencyOffsets); free(adjacency); free(remaining);
+        free(vertexScores); free(triangleScores); free(emitted); free(newIndices); free(remap);
+        return -1;
+    }
+
+    // adjacency: for each vertex the triangles using it. The first `remaining[v]` entries are the not yet emitted ones.
+    for (int i = 0; i < nrTriangles * 3; i++) remaining[indices[i]] += 1;
+    adjacencyOffsets[0] = 0;
+    for (int v = 0; v < nrVertices; v++) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+    for (int v = 0; v < nrVertices; v++) remaining[v] = 0;
+    for (int t = 0; t < nrTriangles; t++) {
+        for (int c = 0; c < 3; c++) {
+            int v = indices[3 * t + c];
+            adjacency[adjacencyOffsets[v] + remaining[v]++] = t;
+        }
+    }
+
+    for (int v = 0; v < nrVertices; v++) {
+        vertexScores[v] = valenceScores[remaining[v] < VERTEX_VALENCE_TABLE_SIZE ? remaining[v] : VERTEX_VALENCE_TABLE_SIZE - 1];
+    }
+    for (int t = 0; t < nrTriangles; t++) {
+        triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+    }
+
+    int cache[VERTEX_CACHE_SIZE + 3];
+    int cacheLength = 0;
+    int bestTriangle = -1;
+    int scanCursor = 0;
+    for (int i = 0; i < nrTriangles; i++) {
+        if (bestTriangle < 0) {
+            // nothing in the cache has triangles left: continue with the next triangle in input-order
+            while (emitted[scanCursor]) scanCursor += 1;
+            bestTriangle = scanCursor;
+        }
+
+        int t = bestTriangle;
+        emitted[t] = 1;
+        int corners[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+        newIndices[3 * i    ] = corners[0];
+        newIndices[3 * i + 1] = corners[1];
+        newIndices[3 * i + 2] = corners[2];
+
+        // remove t from its vertices' lists of remaining triangles
+        for (int c = 0; c < 3; c++) {
+            int v = corners[c];
+            int* list = &adjacency[adjacencyOffsets[v]];
+            for (int k = 0; k < remaining[v]; k++) {
+                if (list[k] == t) {
+                    list[k] = list[remaining[v] - 1];
+                    list[remaining[v] - 1] = t;
+                    break;
+                }
+            }
+            remaining[v] -= 1;
+        }
+
+        // LRU-update: the triangle's vertices move to the front
+        int newCache[VERTEX_CACHE_SIZE + 3];
+        int newLength = 0;
+        for (int c = 0; c < 3; c++) newCache[newLength++] = corners[c];
+        for (int k = 0; k < cacheLength; k++) {
+            int v = cache[k];
+            if (v != corners[0] && v != corners[1] && v != corners[2]) newCache[newLength++] = v;
+        }
+
+        // rescoring every vertex that was or is in the cache, and their remaining triangles
+        for (int k = 0; k < newLength; k++) {
+            int v = newCache[k];
+            int position = k < VERTEX_CACHE_SIZE ? k : -1;
+            float score = remaining[v] == 0 ? -1 :
+                (position >= 0 ? cacheScores[position] : 0) + valenceScores[remaining[v] < VERTEX_VALENCE_TABLE_SIZE ? remaining[v] : VERTEX_VALENCE_TABLE_SIZE - 1];
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+            int* list = &adjacency[adjacencyOffsets[v]];
+            for (int j = 0; j < remaining[v]; j++) triangleScores[list[j]] += delta;
+        }
+        cacheLength = newLength < VERTEX_CACHE_SIZE ? newLength : VERTEX_CACHE_SIZE;
+        for (int k = 0; k < cacheLength; k++) cache[k] = newCache[k];
+
+        // next triangle: the best one touching the cache
+        bestTriangle = -1;
+        float bestScore = -1;
+        for (int k = 0; k < cacheLength; k++) {
+            int v = cache[k];
+            int* list = &adjacency[adjacencyOffsets[v]];
+            for (int j = 0; j < remaining[v]; j++) {
+                if (triangleScores[list[j]] > bestScore) {
+                    bestScore = triangleScores[list[j]];
+                    bestTriangle = list[j];
+                }
+            }
+        }
+    }
+
+    // renumbering vertices in order of first use
+    for (int v = 0; v < nrVertices; v++) remap[v] = -1;
+    int nextVertex = 0;
+    for (int i = 0; i < nrTriangles * 3; i++) {
+        if (remap[newIndices[i]] == -1) remap[newIndices[i]] = nextVertex++;
+        newIndices[i] = remap[newIndices[i]];
+    }
+    // permuting the attributes in place: follow each cycle of the permutation once
+    for (int v = 0; v < nrVertices; v++) {
+        while (remap[v] != v && remap[v] != -1) {
+            int target = remap[v];
+            Vertex p = mesh->positions[target];
+            mesh->positions[target] = mesh->positions[v];
+            mesh->positions[v] = p;
+            Vertex n = mesh->normals[target];
+            mesh->normals[target] = mesh->normals[v];
+            mesh->normals[v] = n;
+            if (mesh->colors) {
+                Vertex c = mesh->colors[target];
+                mesh->colors[target] = mesh->colors[v];
+                mesh->colors[v] = c;
+            }
+            remap[v] = remap[target];
+            remap[target] = target;
+        }
+    }
+
+    free(mesh->indices);
+    mesh->indices = newIndices;
+    free(adjacencyOffsets); free(adjacency); free(remaining);
+    free(vertexScores); free(triangleScores); free(emitted); free(remap);
+    return 0;
+}
+
+
+/**
+ * Average cache miss ratio: vertex-shader invocations per triangle for a FIFO cache of `cacheSize`.
+ * 3 is the worst case (triangle soup), ~0.6 - 0.7 is typical for well-optimized meshes.
+ */
+float getACMR(IndexedMesh* mesh, int cacheSize) {
+    if (mesh->nrTriangles == 0) return 0;
+    int* stamps = malloc(mesh->nrVertices * sizeof(int));  // time at which a vertex entered the cache
+    if (!stamps) return -1;
+    for (int v = 0; v < mesh->nrVertices; v++) stamps[v] = -cacheSize - 1;
+    int time = 0;
+    for (int i = 0; i < mesh->nrTriangles * 3; i++) {
+        int v = mesh->indices[i];
+        if (time - stamps[v] > cacheSize) {
+            stamps[v] = time;
+            time += 1;
+        }
+    }
+    free(stamps);
+    return (float)time / mesh->nrTriangles;
+}
+
+
+typedef struct ChunkWriter {
+    FILE* f;
+    int error;
+    size_t used;
+    unsigned char buffer[1 << 16];
+} ChunkWriter;
+
+
+void chunkFlush(ChunkWriter* w) {
+    if (w->used > 0 && !w->error && fwrite(w->buffer, 1, w->used, w->f) != w->used) w->error = -1;
+    w->used = 0;
+}
+
+
+void chunkWrite(ChunkWriter* w, const void* bytes, size_t length) {
+    const unsigned char* b = bytes;
+    if (length >= sizeof(w->buffer)) {
+        // large arrays are already contiguous in memory - no need to copy them through the buffer
+        chunkFlush(w);
+        if (!w->error && fwrite(b, 1, length, w->f) != length) w->error = -1;
+        return;
+    }
+    while (length > 0) {
+        if (w->used == sizeof(w->buffer)) chunkFlush(w);
+        size_t n = sizeof(w->buffer) - w->used < length ? sizeof(w->buffer) - w->used : length;
+        memcpy(w->buffer + w->used, b, n);
+        w->used += n;
+        b += n;
+        length -= n;
+    }
+}
+
+
+int writeMeshPLY(const char* path, IndexedMesh* mesh) {
+    ChunkWriter* w = malloc(sizeof(ChunkWriter));
+    if (!w) return -1;
+    w->f = fopen(path, "wb");
+    w->error = 0;
+    w->used = 0;
+    if (!w->f) {
+        free(w);
+        return -1;
+    }
+
+    char header[512];
+    int headerLength = snprintf(header, sizeof(header),
+        "ply\nformat binary_little_endian 1.0\n"
+        "element vertex %i\n"
+        "property float x\nproperty float y\nproperty float z\n"
+        "property float nx\nproperty float ny\nproperty float nz\n"
+        "%s"
+        "element face %i\n"
+        "property list uchar uint vertex_indices\n"
+        "end_header\n",
+        mesh->nrVertices,
+        mesh->colors ? "property uchar red\nproperty uchar green\nproperty uchar blue\n" : "",
+        mesh->nrTriangles);
+    chunkWrite(w, header, headerLength);
+
+    for (int v = 0; v < mesh->nrVertices; v++) {
+        chunkWrite(w, &mesh->positions[v], sizeof(Vertex));
+        chunkWrite(w, &mesh->normals[v], sizeof(Vertex));
+        if (mesh->colors) {
+            unsigned char rgb[3] = {
+                min(max(mesh->colors[v].x, 0), 1) * 255,
+                min(max(mesh->colors[v].y, 0), 1) * 255,
+                min(max(mesh->colors[v].z, 0), 1) * 255
+            };
+            chunkWrite(w, rgb, 3);
+        }
+    }
+    for (int t = 0; t < mesh->nrTriangles; t++) {
+        unsigned char three = 3;
+        chunkWrite(w, &three, 1);
+        chunkWrite(w, &mesh->indices[3 * t], 3 * sizeof(unsigned int));
+    }
+
+    chunkFlush(w);
+    int error = w->error;
+    if (fclose(w->f) != 0) error = -1;
+    free(w);
+    return error;
+}
+
+
+/**
+ * Binary glTF 2.0. The BIN-chunk holds indices, positions, normals and (optionally) colors as separate,
+ * tightly packed buffer-views - all of them 4-byte-aligned without any padding.
+ */
+int writeMeshGLB(const char* path, IndexedMesh* mesh) {
+    Vertex pMin = mesh->nrVertices > 0 ? mesh->positions[0] : (Vertex){0, 0, 0};
+    Vertex pMax = pMin;
+    for (int v = 0; v < mesh->nrVertices; v++) {
+        pMin = (Vertex){min(pMin.x, mesh->positions[v].x), min(pMin.y, mesh->positions[v].y), min(pMin.z, mesh->positions[v].z)};
+        pMax = (Vertex){max(pMax.x, mesh->positions[v].x), max(pMax.y, mesh->positions[v].y), max(pMax.z, mesh->positions[v].z)};
+    }
+
+    unsigned int indicesLength = mesh->nrTriangles * 3 * sizeof(unsigned int);
+    unsigned int attributeLength = mesh->nrVertices * sizeof(Vertex);
+    int nrAttributes = mesh->colors ? 3 : 2;
+    unsigned int binLength = indicesLength + attributeLength * nrAttributes;
+
+    char json[2048];
+    int l = 0;
+    l += snprintf(json + l, sizeof(json) - l,
+        "{\"asset\":{\"version\":\"2.0\",\"generator\":\"marchingCubes\"},"
+        "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":1,\"NORMAL\":2%s},\"indices\":0,\"mode\":4}]}],"
+        "\"buffers\":[{\"byteLength\":%u}],"
+        "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%u,\"target\":34963}",
+        mesh->colors ? ",\"COLOR_0\":3" : "", binLength, indicesLength);
+    for (int a = 0; a < nrAttributes; a++) {
+        l += snprintf(json + l, sizeof(json) - l,
+            ",{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34962}",
+            indicesLength + a * attributeLength, attributeLength);
+    }
+    l += snprintf(json + l, sizeof(json) - l,
+        "],\"accessors\":[{\"bufferView\":0,\"componentType\":5125,\"count\":%i,\"type\":\"SCALAR\"},"
+        "{\"bufferView\":1,\"componentType\":5126,\"count\":%i,\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]}",
+        mesh->nrTriangles * 3, mesh->nrVertices, pMin.x, pMin.y, pMin.z, pMax.x, pMax.y, pMax.z);
+    for (int a = 2; a <= nrAttributes; a++) {
+        l += snprintf(json + l, sizeof(json) - l,
+            ",{\"bufferView\":%i,\"componentType\":5126,\"count\":%i,\"type\":\"VEC3\"}", a, mesh->nrVertices);
+    }
+    l += snprintf(json + l, sizeof(json) - l, "]}");
+    if (l >= (int)sizeof(json) - 4) return -1;
+    while (l % 4 != 0) json[l++] = ' ';  // chunks must be 4-byte-aligned; json is padded with spaces
+
+    ChunkWriter* w = malloc(sizeof(ChunkWriter));
+    if (!w) return -1;
+    w->f = fopen(path, "wb");
+    w->error = 0;
+    w->used = 0;
+    if (!w->f) {
+        free(w);
+        return -1;
+    }
+
+    unsigned int header[3] = {0x46546C67, 2, 12 + 8 + l + 8 + binLength};  // "glTF", version, total length
+    unsigned int jsonChunk[2] = {l, 0x4E4F534A};                          // "JSON"
+    unsigned int binChunk[2] = {binLength, 0x004E4942};                   // "BIN"
+    chunkWrite(w, header, sizeof(header));
+    chunkWrite(w, jsonChunk, sizeof(jsonChunk));
+    chunkWrite(w, json, l);
+    chunkWrite(w, binChunk, sizeof(binChunk));
+    chunkWrite(w, mesh->indices, indicesLength);
+    chunkWrite(w, mesh->positions, attributeLength);
+    chunkWrite(w, mesh->normals, attributeLength);
+    if (mesh->colors) chunkWrite(w, mesh->colors, attributeLength);
+
+    chunkFlush(w);
+    int error = w->error;
+    if (fclose(w->f) != 0) error = -1;
+    free(w);
+    return error;
+}
 
 
 void testEdgeTableIndex(float* data, float threshold) {
@@ -725,8 +2106,11 @@ void testMapColors() {
     Vertex vertices[maxNrVertices]; // Allocates `maxNrVertices` slots on the stack - but we won't be using all of them.
     int nrVertices = marchCubes(vertices, data, X, Y, Z, threshold, 1, 1, 1, 0, 0, 0);
 
+    Vertex normals[nrVertices];
+    getNormals(vertices, nrVertices, normals);
+
     Vertex colors[nrVertices];
-    mapColors(data, X, Y, Z, vertices, nrVertices, 1, 1, 1, 0, 0, 0, colors, 0, 1);
+    mapColors(data, X, Y, Z, vertices, nrVertices, 1, 1, 1, 0, 0, 0, normals, colors, 0, 1);
 
     for (int i = 0; i < nrVertices; i++) {
         printf("color %i: [%.2f, %.2f, %.2f]\n", i, colors[i].x, colors[i].y, colors[i].z);
@@ -734,8 +2118,104 @@ void testMapColors() {
 }
 
 
+void testRenderIsosurfacePreview() {
+    int X = 64;
+    int Y = 64;
+    int Z = 64;
+    float* data = malloc(X * Y * Z * sizeof(float));
+    for (int x = 0; x < X; x++) {
+        for (int y = 0; y < Y; y++) {
+            for (int z = 0; z < Z; z++) {
+                float dx = x - 32;
+                float dy = y - 32;
+                float dz = z - 32;
+                data[cubeIndex(Y, Z, x, y, z)] = 20 - __builtin_sqrtf(dx * dx + dy * dy + dz * dz);
+            }
+        }
+    }
+
+    RaycastCamera camera = {{32, 50, 120}, {32, 32, 32}, {0, 1, 0}, 0.577};
+    int errorPPM = renderIsosurfacePreview("sphere.ppm", data, X, Y, Z, 0, 1, 1, 1, 0, 0, 0, camera, 128, 128);
+    int errorPNG = renderIsosurfacePreview("sphere.png", data, X, Y, Z, 0, 1, 1, 1, 0, 0, 0, camera, 128, 128);
+    printf("Error codes: ppm %i, png %i\n", errorPPM, errorPNG);
+    free(data);
+}
+
+
+void testPerlin3DRow() {
+    float row[5];
+    perlin3DRow(row, 5, 0.3, 1.7, -2.2, 0.45);
+    for (int i = 0; i < 5; i++) {
+        printf("perlin3D(0.3, 1.7, %.2f): row %f, single %f\n", -2.2 + i * 0.45, row[i], perlin3D(0.3, 1.7, -2.2 + i * 0.45));
+    }
+}
+
+
+void testGenerateField() {
+    int X = 300;
+    int Y = 100;
+    int Z = 300;
+    float* data = malloc(X * Y * Z * sizeof(float));
+
+    // the scene from fishtank_wasm.ts: three octaves with hand-picked amplitudes
+    FieldTerm terms[4] = {
+        {FIELD_NOISE, COMBINE_ADD, 1, 100, 0, 0, 0, {0, 0, 0}, {1.0 / X, 1.0 / Y, 1.0 / Z}, {0, 0, 0}},
+        {FIELD_NOISE, COMBINE_ADD, 1, 50, 0, 0, 0, {0, 0, 0}, {5.0 / X, 5.0 / Y, 5.0 / Z}, {0, 0, 0}},
+        {FIELD_NOISE, COMBINE_ADD, 1, 10, 0, 0, 0, {0, 0, 0}, {10.0 / X, 10.0 / Y, 10.0 / Z}, {0, 0, 0}},
+        {FIELD_SPHERE, COMBINE_SUBTRACT, 0, 10, 0, 0, 0, {150, 50, 150}, {0, 0, 0}, {30, 0, 0}},
+    };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    generateFieldParallel(data, X, Y, Z, terms, 4, 0);
+    fillBorder(data, X, Y, Z, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    float ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+    printf("Generated %i voxels in %.1f ms. data[1, 1, 1]: %f, data[150, 50, 150]: %f\n",
+        X * Y * Z, ms, data[cubeIndex(Y, Z, 1, 1, 1)], data[cubeIndex(Y, Z, 150, 50, 150)]);
+    free(data);
+}
+
+
+void testExportMesh() {
+    int X = 64;
+    int Y = 64;
+    int Z = 64;
+    float* data = malloc(X * Y * Z * sizeof(float));
+    FieldTerm terms[2] = {
+        {FIELD_SPHERE, COMBINE_ADD, 0, 1, 0, 0, 0, {32, 32, 32}, {0, 0, 0}, {25, 0, 0}},
+        {FIELD_NOISE, COMBINE_ADD, 3, 4, 0.5, 2, 0, {0, 0, 0}, {0.1, 0.1, 0.1}, {0, 0, 0}},
+    };
+    generateField(data, X, Y, Z, terms, 2);
+
+    int maxNrVertices = getMaxNrVertices(X, Y, Z);
+    Vertex* vertices = malloc(maxNrVertices * sizeof(Vertex));
+    int nrVertices = marchCubes(vertices, data, X, Y, Z, 0, 1, 1, 1, 0, 0, 0);
+
+    IndexedMesh mesh;
+    int errorWeld = weldVertices(vertices, NULL, nrVertices, 1.0 / 1024.0, &mesh);
+    free(vertices);
+    float acmrBefore = getACMR(&mesh, 16);
+    int errorOptimize = optimizeVertexCache(&mesh);
+    float acmrAfter = getACMR(&mesh, 16);
+    int errorPLY = writeMeshPLY("mesh.ply", &mesh);
+    int errorGLB = writeMeshGLB("mesh.glb", &mesh);
+
+    printf("Soup vertices: %i, welded vertices: %i, triangles: %i, ACMR (FIFO 16): %.3f -> %.3f\n",
+        nrVertices, mesh.nrVertices, mesh.nrTriangles, acmrBefore, acmrAfter);
+    printf("Error codes: weld %i, optimize %i, ply %i, glb %i\n", errorWeld, errorOptimize, errorPLY, errorGLB);
+    freeIndexedMesh(&mesh);
+    free(data);
+}
+
+
 int main() {
     testMapColors();
+    testRenderIsosurfacePreview();
+    testPerlin3DRow();
+    testGenerateField();
+    testExportMesh();
     return 0;
 }
 #endif
\ No newline at end of file
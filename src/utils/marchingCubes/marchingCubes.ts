@@ -1,6 +1,6 @@
 import { from, Observable } from 'rxjs';
 import { map } from 'rxjs/operators';
-import { BufferAttribute, BufferGeometry, DoubleSide, Mesh, MeshLambertMaterial, MeshPhongMaterial, MeshStandardMaterial } from 'three';
+import { Box3, BufferAttribute, BufferGeometry, Camera, DoubleSide, Frustum, Matrix4, Mesh, MeshLambertMaterial, MeshPhongMaterial, MeshStandardMaterial, Vector3 } from 'three';
 import { ArrayCubeF32 } from '../arrayMatrix';
 
 
@@ -131,6 +131,70 @@ export class MarchingCubeService {
         return copy;
     }
 
+
+    /**
+     * Fills a X*Y*Z volume from `terms` inside wasm - the volume is written straight into wasm memory
+     * and copied out once, instead of being filled voxel by voxel from JS.
+     * If `borderValue` is given, the outer faces of the volume are set to it, so that meshes come out closed.
+     */
+    generateField(X: number, Y: number, Z: number, terms: FieldTerm[], borderValue?: number): Float32Array {
+
+        // volume placeholder in memory
+        const volumeAddress = this.exports.__heap_base;
+        const volume = new Float32Array(this.memory.buffer, volumeAddress, X * Y * Z);
+
+        // writing terms into memory, laid out like `FieldTerm` in main.c
+        const termsAddress = volumeAddress + volume.length * volume.BYTES_PER_ELEMENT;
+        const termsInts = new Int32Array(this.memory.buffer, termsAddress, terms.length * FIELD_TERM_LENGTH);
+        const termsFloats = new Float32Array(this.memory.buffer, termsAddress, terms.length * FIELD_TERM_LENGTH);
+        terms.forEach((term, i) => {
+            const o = i * FIELD_TERM_LENGTH;
+            termsInts[o + 0] = FIELD_TYPES.indexOf(term.type);
+            termsInts[o + 1] = FIELD_COMBINES.indexOf(term.combine || 'add');
+            termsInts[o + 2] = term.octaves !== undefined ? term.octaves : 1;
+            termsFloats[o + 3] = term.amplitude !== undefined ? term.amplitude : 1;
+            termsFloats[o + 4] = term.persistence !== undefined ? term.persistence : 0.5;
+            termsFloats[o + 5] = term.lacunarity !== undefined ? term.lacunarity : 2;
+            termsFloats[o + 6] = term.thickness || 0;
+            termsFloats.set(term.center || [0, 0, 0], o + 7);
+            termsFloats.set(term.scale || [1, 1, 1], o + 10);
+            termsFloats.set(term.size || [0, 0, 0], o + 13);
+        });
+
+        // generating field
+        (this.exports['generateField'] as Function)(volumeAddress, X, Y, Z, termsAddress, terms.length);
+        if (borderValue !== undefined) {
+            (this.exports['fillBorder'] as Function)(volumeAddress, X, Y, Z, borderValue);
+        }
+
+        // returning result memory copy
+        return volume.slice();
+    }
+
+}
+
+
+
+export type FieldType = 'noise' | 'sphere' | 'box' | 'gyroid';
+export type FieldCombine = 'add' | 'union' | 'intersect' | 'subtract';
+const FIELD_TYPES: FieldType[] = ['noise', 'sphere', 'box', 'gyroid'];           // same order as FIELD_* in main.c
+const FIELD_COMBINES: FieldCombine[] = ['add', 'union', 'intersect', 'subtract'];  // same order as COMBINE_* in main.c
+const FIELD_TERM_LENGTH = 16; // 4-byte-words per `FieldTerm` in main.c
+
+/**
+ * One ingredient of a procedural volume; see `FieldTerm` in main.c. All positions are in voxels.
+ */
+export interface FieldTerm {
+    type: FieldType;
+    combine?: FieldCombine;                 // how this term is merged with the ones before it. Default: 'add'
+    octaves?: number;                       // noise. Default: 1
+    amplitude?: number;                     // Default: 1
+    persistence?: number;                   // noise: amplitude-factor per octave. Default: 0.5
+    lacunarity?: number;                    // noise: frequency-factor per octave. Default: 2
+    thickness?: number;                     // gyroid
+    center?: [number, number, number];
+    scale?: [number, number, number];       // noise, gyroid: frequency per axis. Default: [1, 1, 1]
+    size?: [number, number, number];        // sphere: radius = size[0]; box: half-extents
 }
 
 
@@ -160,13 +224,10 @@ export class BlockContainer {
         public threshold: number,
         public cubeSize: [number, number, number],
         public minVal: number,
-        public maxVal: number) {
+        public maxVal: number,
+        deferMeshing = false) {  // if true, the mesh starts out empty until someone calls `remesh`
 
-        const attrs = this.calculateAttributes();
         const geometry = new BufferGeometry();
-        geometry.setAttribute('position', attrs.position);
-        geometry.setAttribute('normal', attrs.normal);
-        geometry.setAttribute('color', attrs.color);
         const material = new MeshStandardMaterial({
             vertexColors: true,
             side: DoubleSide,
@@ -175,20 +236,24 @@ export class BlockContainer {
         const mesh = new Mesh(geometry, material);
 
         this.mesh = mesh;
+        if (!deferMeshing) {
+            this.remesh();
+        }
     }
 
     public getBbox(): Bbox {
         const startPointWorldCoords = this.mesh.position.toArray();
-        const xLength = this.blockSize[0] * this.cubeSize[0];
-        const yLength = this.blockSize[1] * this.cubeSize[1];
-        const zLength = this.blockSize[2] * this.cubeSize[2];
+        // `blockSize` counts data-points; n data-points span n - 1 cubes.
+        const xLength = (this.blockSize[0] - 1) * this.cubeSize[0];
+        const yLength = (this.blockSize[1] - 1) * this.cubeSize[1];
+        const zLength = (this.blockSize[2] - 1) * this.cubeSize[2];
         return {
             xMin: startPointWorldCoords[0],
             yMin: startPointWorldCoords[1],
             zMin: startPointWorldCoords[2],
-            xMax: startPointWorldCoords[0] + 2 * xLength,
-            yMax: startPointWorldCoords[1] + 2 * yLength,
-            zMax: startPointWorldCoords[2] + 2 * zLength,
+            xMax: startPointWorldCoords[0] + xLength,
+            yMax: startPointWorldCoords[1] + yLength,
+            zMax: startPointWorldCoords[2] + zLength,
         };
     }
 
@@ -200,18 +265,28 @@ export class BlockContainer {
 
     public updateData(data: Float32Array): void {
         this.data = data;
-        const attrs = this.calculateAttributes();
-        (this.mesh.geometry as BufferGeometry).setAttribute('position', attrs.position);
-        (this.mesh.geometry as BufferGeometry).setAttribute('normal', attrs.normal);
-        (this.mesh.geometry as BufferGeometry).setAttribute('color', attrs.color);
+        this.remesh();
     }
 
     public updateThreshold(threshold: number): void {
         this.threshold = threshold;
+        this.remesh();
+    }
+
+    /**
+     * Re-runs marching cubes on the current `data` and `threshold`.
+     * Set those fields directly and let a `BlockMeshScheduler` call this if you don't want to mesh right away.
+     */
+    public remesh(): void {
         const attrs = this.calculateAttributes();
-        (this.mesh.geometry as BufferGeometry).setAttribute('position', attrs.position);
-        (this.mesh.geometry as BufferGeometry).setAttribute('normal', attrs.normal);
-        (this.mesh.geometry as BufferGeometry).setAttribute('color', attrs.color);
+        const geometry = this.mesh.geometry as BufferGeometry;
+        geometry.setAttribute('position', attrs.position);
+        geometry.setAttribute('normal', attrs.normal);
+        geometry.setAttribute('color', attrs.color);
+        // three caches the bounds for frustum-culling and `setAttribute` doesn't reset them.
+        // Without this, a block that was rendered while still empty would be culled by its origin forever.
+        geometry.computeBoundingSphere();
+        geometry.computeBoundingBox();
     }
 
     private calculateAttributes() {
@@ -241,7 +316,8 @@ export function createMarchingCubeBlockMeshes(
     data: ArrayCubeF32, threshold: number,
     cubeSize: [number, number, number], blockSize: [number, number, number],
     minVal: number, maxVal: number,
-    mcSvc: MarchingCubeService): BlockContainer[] {
+    mcSvc: MarchingCubeService,
+    scheduler?: BlockMeshScheduler): BlockContainer[] {
     const blocks: BlockContainer[] = [];
 
     const X = data.X;
@@ -267,10 +343,14 @@ export function createMarchingCubeBlockMeshes(
                 const container = new BlockContainer(
                     mcSvc, startPoint, blockSizeAdjusted, subBlockData.data,
                     [subBlockData.X, subBlockData.Y, subBlockData.Z],
-                    threshold, cubeSize, minVal, maxVal
+                    threshold, cubeSize, minVal, maxVal,
+                    !!scheduler
                 );
                 container.translate([x0 * cubeSize[0], y0 * cubeSize[1], z0 * cubeSize[2]]);
                 blocks.push(container);
+                if (scheduler) {
+                    scheduler.schedule(container);
+                }
 
                 z0 += blockSize[2] - 1;
             }
@@ -280,4 +360,100 @@ export function createMarchingCubeBlockMeshes(
     }
 
     return blocks;
-}
\ No newline at end of file
+}
+
+
+
+/**
+ * Queues block-(re)meshing jobs and works them off a few per frame instead of all at once.
+ *  - Call `runFrame` once per `requestAnimationFrame`. It keeps meshing until `budgetMs` is used up,
+ *    but always does at least one block, so the queue keeps moving even if single blocks are expensive.
+ *    (A single block can't be split, so keep blocks small enough that one of them fits into a frame.)
+ *  - Blocks inside the camera frustum go first, nearest first. Priorities are re-evaluated every frame,
+ *    so turning the camera mid-update re-orders the rest of the queue.
+ *  - Jobs are keyed per block and per `key`. Scheduling the same key again replaces the older, not yet run job -
+ *    dragging a slider only ever meshes the latest value. A block is remeshed once, after all its pending jobs ran.
+ */
+export class BlockMeshScheduler {
+
+    private pending = new Map<BlockContainer, Map<string, () => void>>();
+    private frustum = new Frustum();
+    private projectionScreenMatrix = new Matrix4();
+
+    constructor(
+        private camera: Camera,
+        public budgetMs = 4) {}
+
+    /**
+     * @param prepare: runs right before the block is remeshed, e.g. to compute new data.
+     *                 Do expensive work in here instead of in the event-handler, so that it can be cancelled, too.
+     */
+    public schedule(block: BlockContainer, key = 'remesh', prepare?: () => void): void {
+        let jobs = this.pending.get(block);
+        if (!jobs) {
+            jobs = new Map<string, () => void>();
+            this.pending.set(block, jobs);
+        }
+        jobs.set(key, prepare || (() => {}));
+    }
+
+    public cancel(block: BlockContainer): void {
+        this.pending.delete(block);
+    }
+
+    public get nrPending(): number {
+        return this.pending.size;
+    }
+
+    /**
+     * @returns the number of blocks that have been remeshed.
+     */
+    public runFrame(): number {
+        if (this.pending.size === 0) {
+            return 0;
+        }
+
+        const start = performance.now();
+        const ordered = this.prioritize();
+        let nrDone = 0;
+        for (const block of ordered) {
+            const jobs = this.pending.get(block);
+            this.pending.delete(block);
+            jobs.forEach(prepare => prepare());
+            block.remesh();
+            nrDone += 1;
+            if (performance.now() - start >= this.budgetMs) {
+                break;
+            }
+        }
+        return nrDone;
+    }
+
+    private prioritize(): BlockContainer[] {
+        this.camera.updateMatrixWorld();
+        this.projectionScreenMatrix.multiplyMatrices(this.camera.projectionMatrix, this.camera.matrixWorldInverse);
+        this.frustum.setFromProjectionMatrix(this.projectionScreenMatrix);
+        const cameraPosition = new Vector3().setFromMatrixPosition(this.camera.matrixWorld);
+
+        const candidates: { block: BlockContainer, visible: boolean, distance: number }[] = [];
+        this.pending.forEach((jobs, block) => {
+            const bbox = block.getBbox();
+            const box = new Box3(
+                new Vector3(bbox.xMin, bbox.yMin, bbox.zMin),
+                new Vector3(bbox.xMax, bbox.yMax, bbox.zMax));
+            candidates.push({
+                block,
+                visible: this.frustum.intersectsBox(box),
+                distance: box.distanceToPoint(cameraPosition)
+            });
+        });
+
+        candidates.sort((a, b) => {
+            if (a.visible !== b.visible) {
+                return a.visible ? -1 : 1;
+            }
+            return a.distance - b.distance;
+        });
+        return candidates.map(c => c.block);
+    }
+}